@@ -0,0 +1,63 @@
+//
+//  codec_bench.cpp
+//  cppwebsocket
+//
+//  Frame encode / parse throughput, no socket involved.
+//
+//  c++ -std=c++11 -O2 -Icppwebsocket bench/codec_bench.cpp -o codec_bench
+//  ./codec_bench [payload-size] [frames]
+//
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "FrameCodec.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+template<cppws::FrameRole R>
+static void run(const char *name, size_t payloadSize, size_t frames) {
+    typedef cppws::FrameEncoder<R> Encoder;
+    const uint8_t maskingKey[4] = { 0x12, 0x34, 0x56, 0x78 };
+    std::vector<uint8_t> payload(payloadSize, 'x');
+    std::vector<uint8_t> wire((Encoder::headerSize(payloadSize) + payloadSize) * frames);
+
+    Clock::time_point start = Clock::now();
+    uint8_t *out = wire.data();
+    for (size_t i = 0; i != frames; ++i) {
+        out += Encoder::writeHeader(out, cppws::WebSocketHeader::BINARY_FRAME, payloadSize, maskingKey);
+        if (payloadSize) {
+            memcpy(out, payload.data(), payloadSize);
+        }
+        Encoder::maskPayload(out, payloadSize, maskingKey);
+        out += payloadSize;
+    }
+    Clock::time_point encoded = Clock::now();
+
+    cppws::FrameParser parser(wire.data(), wire.size());
+    cppws::WebSocketHeader ws;
+    uint8_t *frame;
+    size_t parsed = 0;
+    uint64_t checksum = 0;
+    while (parser.next(ws, frame)) {
+        checksum += ws.N ? frame[ws.N - 1] : 0;
+        ++parsed;
+    }
+    Clock::time_point decoded = Clock::now();
+
+    double mb = wire.size() / (1024.0 * 1024.0);
+    double encodeSec = std::chrono::duration<double>(encoded - start).count();
+    double decodeSec = std::chrono::duration<double>(decoded - encoded).count();
+    std::cout << name << " payload=" << payloadSize << " frames=" << parsed
+              << " encode=" << mb / encodeSec << "MB/s " << encodeSec * 1e9 / frames << "ns/frame"
+              << " decode=" << mb / decodeSec << "MB/s " << decodeSec * 1e9 / frames << "ns/frame"
+              << " (" << checksum << ")" << std::endl;
+}
+
+int main(int argc, const char * argv[]) {
+    size_t payloadSize = argc > 1 ? (size_t)atol(argv[1]) : 64;
+    size_t frames = argc > 2 ? (size_t)atol(argv[2]) : 1000000;
+    run<cppws::ROLE_CLIENT>("client", payloadSize, frames);
+    run<cppws::ROLE_SERVER>("server", payloadSize, frames);
+    return 0;
+}
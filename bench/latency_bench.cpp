@@ -0,0 +1,108 @@
+//
+//  latency_bench.cpp
+//  cppwebsocket
+//
+//  Round trip latency against an echo server, one message in flight at a time.
+//  Anything that sends a text frame back works, testserver/pywebsocket.py
+//  included (it prefixes the user name, the sequence number is looked up by '#').
+//
+//  c++ -std=c++11 -O2 -pthread -Icppwebsocket bench/latency_bench.cpp cppwebsocket/*.cpp -o latency_bench
+//  ./latency_bench ws://127.0.0.1:12345/chat [blocking|spin|hybrid] [count] [cpu] [busypoll-us]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "WebSocketClient.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t percentile(const std::vector<uint64_t> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, const char * argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " url [blocking|spin|hybrid] [count] [cpu] [busypoll-us]" << std::endl;
+        return 1;
+    }
+    std::string url = argv[1];
+    std::string mode = argc > 2 ? argv[2] : "blocking";
+    size_t count = argc > 3 ? (size_t)atol(argv[3]) : 10000;
+    int cpu = argc > 4 ? atoi(argv[4]) : -1;
+    int busyPoll = argc > 5 ? atoi(argv[5]) : 0;
+    const size_t warmup = std::min<size_t>(count / 10, 1000);
+
+    cppws::WebSocketClient ws({url});
+    if (mode == "spin") {
+        ws.setPollMode(cppws::POLL_SPIN);
+    }
+    else if (mode == "hybrid") {
+        ws.setPollMode(cppws::POLL_HYBRID, 200);
+    }
+    else if (mode != "blocking") {
+        std::cerr << "unknown mode: " << mode << std::endl;
+        return 1;
+    }
+    ws.pinToCpu(cpu);
+    ws.setBusyPoll(busyPoll);
+
+    std::vector<uint64_t> rtts;
+    rtts.reserve(count);
+    size_t seq = 0;
+    Clock::time_point sentAt;
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished = false;
+
+    // the next request goes out from the I/O thread as soon as the reply is in,
+    // so what gets measured is how fast the loop notices incoming data
+    auto sendNext = [&] {
+        sentAt = Clock::now();
+        ws.sendMessage("#" + std::to_string(seq));
+    };
+    auto finish = [&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        done.notify_all();
+    };
+    ws.onOpen = sendNext;
+    ws.onMessage = [&](const std::string &message) {
+        size_t pos = message.rfind('#');
+        if (pos == std::string::npos || (size_t)atol(message.c_str() + pos + 1) != seq) {
+            return;
+        }
+        uint64_t rtt = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sentAt).count();
+        if (seq >= warmup) {
+            rtts.push_back(rtt);
+        }
+        if (++seq == count + warmup) {
+            finish();
+            return;
+        }
+        sendNext();
+    };
+    ws.onClosed = finish;
+    ws.open();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]{ return finished; });
+    }
+    ws.close();
+
+    std::sort(rtts.begin(), rtts.end());
+    std::cout << "mode=" << mode << " samples=" << rtts.size()
+              << " p50=" << percentile(rtts, 0.50) / 1000.0 << "us"
+              << " p90=" << percentile(rtts, 0.90) / 1000.0 << "us"
+              << " p99=" << percentile(rtts, 0.99) / 1000.0 << "us"
+              << " max=" << (rtts.empty() ? 0 : rtts.back()) / 1000.0 << "us" << std::endl;
+    return 0;
+}
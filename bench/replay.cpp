@@ -0,0 +1,76 @@
+//
+//  replay.cpp
+//  cppwebsocket
+//
+//  Pushes a capture recorded with WebSocketClient::captureTo() through the
+//  client's frame extraction and dispatch, no network needed, and reports
+//  throughput and cost per message. Rates count only the time spent parsing
+//  and dispatching, so they compare across builds in --paced mode as well.
+//
+//  c++ -std=c++11 -O2 -pthread -Icppwebsocket bench/replay.cpp cppwebsocket/*.cpp -o replay
+//  ./replay session.cap [--paced] [--pool threads] [--repeat n]
+//
+
+#include <iostream>
+#include <string>
+#include "WebSocketClient.hpp"
+
+int main(int argc, const char * argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " capture [--paced] [--pool threads] [--repeat n]" << std::endl;
+        return 1;
+    }
+    bool paced = false;
+    size_t poolThreads = 0;
+    int repeat = 1;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--paced") {
+            paced = true;
+        }
+        else if (arg == "--pool" && i + 1 < argc) {
+            poolThreads = (size_t)atol(argv[++i]);
+        }
+        else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        }
+        else {
+            std::cerr << "unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    cppws::CaptureFile capture;
+    if (!capture.open(argv[1])) {
+        return 1;
+    }
+
+    cppws::WebSocketClient ws({});
+    std::shared_ptr<cppws::WorkerPool> pool;
+    if (poolThreads > 0) {
+        pool = std::make_shared<cppws::WorkerPool>(poolThreads);
+        ws.dispatchOn(pool);
+    }
+    uint64_t payloadBytes = 0;
+    ws.onMessage = [&payloadBytes](const std::string &message) {
+        payloadBytes += message.size();
+    };
+
+    cppws::FrameReplayer replayer(ws);
+    for (int run = 0; run < repeat; ++run) {
+        capture.rewind();
+        cppws::ReplayStats stats = replayer.replay(capture, paced);
+        std::cout << "run=" << run
+                  << " connections=" << stats.connections
+                  << " bytes=" << stats.bytes
+                  << " chunks=" << stats.chunks
+                  << " messages=" << stats.messages
+                  << " wall=" << stats.seconds * 1000.0 << "ms"
+                  << " busy=" << stats.busySeconds * 1000.0 << "ms"
+                  << " " << stats.bytes / (1024.0 * 1024.0) / stats.busySeconds << "MB/s"
+                  << " " << stats.messages / stats.busySeconds << "msg/s"
+                  << " " << (stats.messages ? stats.busySeconds * 1e9 / stats.messages : 0) << "ns/msg" << std::endl;
+    }
+    std::cout << "payload bytes delivered=" << payloadBytes << std::endl;
+    return 0;
+}
@@ -0,0 +1,256 @@
+//
+//  FrameCapture.cpp
+//  cppwebsocket
+//
+//  Capture of received bytes and memory-mapped replay through the client.
+//
+
+#include "FrameCapture.hpp"
+#include "WebSocketClient.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <thread>
+
+namespace cppws {
+
+    static const char captureMagic[8] = { 'C', 'W', 'S', 'C', 'A', 'P', '0', '1' };
+    static const size_t recordHeaderSize = 12;
+    static const uint32_t connectionMarker = 0xffffffff;
+
+    static void putLE(uint8_t *out, uint64_t value, unsigned bytes) {
+        for (unsigned i = 0; i != bytes; ++i) {
+            out[i] = (value >> (8 * i)) & 0xff;
+        }
+    }
+
+    static uint64_t getLE(const uint8_t *in, unsigned bytes) {
+        uint64_t value = 0;
+        for (unsigned i = bytes; i != 0; --i) {
+            value = (value << 8) | in[i - 1];
+        }
+        return value;
+    }
+
+    FrameCaptureWriter::FrameCaptureWriter() {
+        file_ = NULL;
+    }
+
+    FrameCaptureWriter::~FrameCaptureWriter() {
+        close();
+    }
+
+    bool FrameCaptureWriter::open(const std::string &path) {
+        close();
+        file_ = fopen(path.c_str(), "wb");
+        if (file_ == NULL) {
+            fprintf(stderr, "ERROR: Could not open capture file: %s\n", path.c_str());
+            return false;
+        }
+        fwrite(captureMagic, 1, sizeof(captureMagic), file_);
+        start_ = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    bool FrameCaptureWriter::isOpen() const {
+        return file_ != NULL;
+    }
+
+    void FrameCaptureWriter::append(const uint8_t *data, size_t size) {
+        if (file_ == NULL) {
+            return;
+        }
+        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+        uint8_t header[recordHeaderSize];
+        putLE(header, nanos, 8);
+        putLE(header + 8, size, 4);
+        fwrite(header, 1, sizeof(header), file_);
+        if (size > 0 && data != NULL) {
+            fwrite(data, 1, size, file_);
+        }
+    }
+
+    void FrameCaptureWriter::beginConnection() {
+        append(NULL, connectionMarker);
+    }
+
+    void FrameCaptureWriter::flush() {
+        if (file_ != NULL) {
+            fflush(file_);
+        }
+    }
+
+    void FrameCaptureWriter::close() {
+        if (file_ != NULL) {
+            fclose(file_);
+            file_ = NULL;
+        }
+    }
+
+    CaptureFile::CaptureFile() {
+        data_ = NULL;
+        size_ = 0;
+        offset_ = 0;
+    }
+
+    CaptureFile::~CaptureFile() {
+        close();
+    }
+
+    bool CaptureFile::open(const std::string &path) {
+        close();
+#ifdef _WIN32
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+            fprintf(stderr, "ERROR: Could not open capture file: %s\n", path.c_str());
+            return false;
+        }
+        uint8_t buff[64 * 1024];
+        size_t n;
+        while ((n = fread(buff, 1, sizeof(buff), file)) > 0) {
+            fallback_.insert(fallback_.end(), buff, buff + n);
+        }
+        fclose(file);
+        data_ = fallback_.empty() ? NULL : &fallback_[0];
+        size_ = fallback_.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "ERROR: Could not open capture file: %s\n", path.c_str());
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            fprintf(stderr, "ERROR: Empty capture file: %s\n", path.c_str());
+            return false;
+        }
+        void *mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            fprintf(stderr, "ERROR: Could not map capture file: %s\n", path.c_str());
+            return false;
+        }
+        data_ = (const uint8_t *)mapped;
+        size_ = (size_t)st.st_size;
+#endif
+        if (size_ < sizeof(captureMagic) || memcmp(data_, captureMagic, sizeof(captureMagic)) != 0) {
+            fprintf(stderr, "ERROR: Not a capture file: %s\n", path.c_str());
+            close();
+            return false;
+        }
+        offset_ = sizeof(captureMagic);
+        return true;
+    }
+
+    void CaptureFile::close() {
+#ifndef _WIN32
+        if (data_ != NULL) {
+            munmap((void *)data_, size_);
+        }
+#endif
+        std::vector<uint8_t>().swap(fallback_);
+        data_ = NULL;
+        size_ = 0;
+        offset_ = 0;
+    }
+
+    bool CaptureFile::next(CaptureRecord &record) {
+        if (size_ - offset_ < recordHeaderSize) {
+            return false;
+        }
+        const uint8_t *header = data_ + offset_;
+        uint32_t size = (uint32_t)getLE(header + 8, 4);
+        record.timestampNanos = getLE(header, 8);
+        if (size == connectionMarker) {
+            record.connectionStart = true;
+            record.size = 0;
+            record.data = NULL;
+            offset_ += recordHeaderSize;
+            return true;
+        }
+        if (size_ - offset_ - recordHeaderSize < size) {
+            fprintf(stderr, "WARNING: Capture file is truncated\n");
+            return false;
+        }
+        record.connectionStart = false;
+        record.size = size;
+        record.data = header + recordHeaderSize;
+        offset_ += recordHeaderSize + size;
+        return true;
+    }
+
+    void CaptureFile::rewind() {
+        offset_ = data_ != NULL ? sizeof(captureMagic) : 0;
+    }
+
+    FrameReplayer::FrameReplayer(WebSocketClient &client): client_(client) {
+    }
+
+    ReplayStats FrameReplayer::replay(CaptureFile &capture, bool paced) {
+        typedef std::chrono::steady_clock Clock;
+        ReplayStats stats = ReplayStats();
+        CaptureRecord record;
+        bool first = true;
+        uint64_t paceOrigin = 0;
+        Clock::duration busy = Clock::duration::zero();
+        ReadyStateValues readyState = client_.readyState_;
+
+        client_.recvBuff_.clear();
+        client_.recvMessage_.clear();
+        client_.readyState_ = INIT;
+        Clock::time_point start = Clock::now();
+        Clock::time_point paceStart = start;
+        while (capture.next(record)) {
+            if (record.connectionStart) {
+                // a new connection shares nothing with the previous one, and
+                // the reconnect gap is not worth waiting for
+                client_.recvBuff_.clear();
+                client_.recvMessage_.clear();
+                client_.readyState_ = INIT;
+                paceOrigin = record.timestampNanos;
+                paceStart = Clock::now();
+                first = false;
+                stats.connections++;
+                continue;
+            }
+            if (paced) {
+                if (first) {
+                    paceOrigin = record.timestampNanos;
+                }
+                std::this_thread::sleep_until(paceStart + std::chrono::nanoseconds(record.timestampNanos - paceOrigin));
+            }
+            first = false;
+
+            // same path as a recv() in runPollInThread
+            Clock::time_point chunkStart = Clock::now();
+            client_.recvBuff_.insert(client_.recvBuff_.end(), record.data, record.data + record.size);
+            stats.messages += client_.dispatchReceived();
+            busy += Clock::now() - chunkStart;
+            stats.bytes += record.size;
+            stats.chunks++;
+
+            if (client_.pendingSend_ != 0) {
+                std::lock_guard<std::recursive_mutex> lock(client_.sendMutex_);
+                client_.sendBuff_.clear();
+                client_.pendingSend_ = 0;
+            }
+        }
+        if (client_.executor_) {
+            Clock::time_point drainStart = Clock::now();
+            client_.executor_->drain();
+            busy += Clock::now() - drainStart;
+        }
+        stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        stats.busySeconds = std::chrono::duration<double>(busy).count();
+
+        client_.recvBuff_.clear();
+        client_.recvMessage_.clear();
+        client_.readyState_ = readyState;
+        return stats;
+    }
+}
@@ -0,0 +1,102 @@
+//
+//  FrameCapture.hpp
+//  cppwebsocket
+//
+//  Capture of received bytes and memory-mapped replay through the client.
+//
+
+#ifndef FrameCapture_hpp
+#define FrameCapture_hpp
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace cppws {
+
+    class WebSocketClient;
+
+    // Capture file layout, all integers little endian:
+    //
+    //   "CWSCAP01"                                  8 bytes, once
+    // then one record per recv() call, so replay sees the same read boundaries:
+    //   uint64 nanoseconds since capture start
+    //   uint32 chunk size
+    //   chunk bytes
+    // A record with chunk size 0xffffffff and no bytes marks the start of a
+    // connection, one capture can hold several.
+    class FrameCaptureWriter {
+    public:
+        FrameCaptureWriter();
+        ~FrameCaptureWriter();
+        FrameCaptureWriter(const FrameCaptureWriter &) = delete;
+        FrameCaptureWriter &operator=(const FrameCaptureWriter &) = delete;
+
+        bool open(const std::string &path);
+        bool isOpen() const;
+        void append(const uint8_t *data, size_t size);
+        void beginConnection();
+        void flush();
+        void close();
+
+    private:
+        FILE *file_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    struct CaptureRecord {
+        uint64_t timestampNanos;
+        bool connectionStart;   // marker only, no data
+        const uint8_t *data;
+        uint32_t size;
+    };
+
+    // Read side, maps the whole file and hands out records pointing into it.
+    class CaptureFile {
+    public:
+        CaptureFile();
+        ~CaptureFile();
+        CaptureFile(const CaptureFile &) = delete;
+        CaptureFile &operator=(const CaptureFile &) = delete;
+
+        bool open(const std::string &path);
+        void close();
+        bool next(CaptureRecord &record);
+        void rewind();
+
+    private:
+        const uint8_t *data_;
+        size_t size_;
+        size_t offset_;
+        std::vector<uint8_t> fallback_;  // used where there is no mmap
+    };
+
+    struct ReplayStats {
+        uint64_t bytes;
+        uint64_t chunks;
+        uint64_t messages;
+        uint64_t connections;
+        double busySeconds;     // parsing and dispatch only, rates are based on this
+        double seconds;         // wall time, includes pacing
+    };
+
+    // Feeds a capture through the client's own frame extraction and message
+    // dispatch, without a socket. The client must not be open. Anything the
+    // client would send back (PONG, CLOSE) is thrown away, and the client's
+    // state is put back afterwards so every run exercises the same code.
+    class FrameReplayer {
+    public:
+        FrameReplayer(WebSocketClient &client);
+
+        // paced: wait for each chunk's recorded time instead of going flat out
+        ReplayStats replay(CaptureFile &capture, bool paced=false);
+
+    private:
+        WebSocketClient &client_;
+    };
+}
+
+#endif /* FrameCapture_hpp */
@@ -0,0 +1,235 @@
+//
+//  FrameCodec.hpp
+//  cppwebsocket
+//
+//  Header-only WebSocket frame encoder and parser, usable without a socket.
+//
+
+#ifndef FrameCodec_hpp
+#define FrameCodec_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace cppws {
+
+    // http://tools.ietf.org/html/rfc6455#section-5.2  Base Framing Protocol
+    //
+    //  0                   1                   2                   3
+    //  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+    // +-+-+-+-+-------+-+-------------+-------------------------------+
+    // |F|R|R|R| opcode|M| Payload len |    Extended payload length    |
+    // |I|S|S|S|  (4)  |A|     (7)     |             (16/64)           |
+    // |N|V|V|V|       |S|             |   (if payload len==126/127)   |
+    // | |1|2|3|       |K|             |                               |
+    // +-+-+-+-+-------+-+-------------+ - - - - - - - - - - - - - - - +
+    // |     Extended payload length continued, if payload len == 127  |
+    // + - - - - - - - - - - - - - - - +-------------------------------+
+    // |                               |Masking-key, if MASK set to 1  |
+    // +-------------------------------+-------------------------------+
+    // | Masking-key (continued)       |          Payload Data         |
+    // +-------------------------------- - - - - - - - - - - - - - - - +
+    // :                     Payload Data continued ...                :
+    // + - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - +
+    // |                     Payload Data continued ...                |
+    // +---------------------------------------------------------------+
+    struct WebSocketHeader {
+        unsigned headerSize;
+        bool fin;
+        bool mask;
+        enum OpcodeType {
+            CONTINUATION = 0x0,
+            TEXT_FRAME = 0x1,
+            BINARY_FRAME = 0x2,
+            CLOSE = 8,
+            PING = 9,
+            PONG = 0xa,
+        } opcode;
+        int N0;
+        uint64_t N;
+        uint8_t maskingKey[4];
+    };
+
+    // a client masks every frame it sends, a server never does
+    enum FrameRole: int {
+        ROLE_CLIENT,
+        ROLE_SERVER,
+    };
+
+    // which payload length encoding a frame uses
+    enum FrameLengthClass: int {
+        LENGTH_7BIT,    // < 126
+        LENGTH_16BIT,   // < 65536
+        LENGTH_64BIT,
+    };
+
+    const unsigned kMaxFrameHeaderSize = 14;
+
+    constexpr FrameLengthClass frameLengthClass(uint64_t payloadSize) {
+        return payloadSize < 126 ? LENGTH_7BIT : (payloadSize < 65536 ? LENGTH_16BIT : LENGTH_64BIT);
+    }
+
+    template<FrameRole R>
+    struct FrameTraits {
+        static constexpr bool masked = R == ROLE_CLIENT;
+        // header size indexed by FrameLengthClass
+        static constexpr unsigned headerSize[3] = {
+            2 + (masked ? 4u : 0u),
+            4 + (masked ? 4u : 0u),
+            10 + (masked ? 4u : 0u),
+        };
+    };
+    template<FrameRole R> constexpr bool FrameTraits<R>::masked;
+    template<FrameRole R> constexpr unsigned FrameTraits<R>::headerSize[3];
+
+    // xor `size` bytes with the masking key, `offset` is the position of data[0] in the payload
+    inline void maskPayload(uint8_t *data, size_t size, const uint8_t maskingKey[4], size_t offset=0) {
+        uint8_t key[8];
+        for (size_t i = 0; i != 8; ++i) {
+            key[i] = maskingKey[(offset + i) & 0x3];
+        }
+        uint64_t key8;
+        memcpy(&key8, key, 8);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            word ^= key8;
+            memcpy(data + i, &word, 8);
+        }
+        for (; i != size; ++i) {
+            data[i] ^= key[i & 0x7];
+        }
+    }
+
+    // Writes frame headers straight into caller memory, the role decides at
+    // compile time whether a masking key goes in.
+    template<FrameRole R>
+    struct FrameEncoder {
+        static constexpr bool masked = FrameTraits<R>::masked;
+
+        static unsigned headerSize(uint64_t payloadSize) {
+            return FrameTraits<R>::headerSize[frameLengthClass(payloadSize)];
+        }
+
+        // `out` needs room for kMaxFrameHeaderSize bytes, returns the bytes written.
+        // `maskingKey` is ignored by the server role
+        static unsigned writeHeader(uint8_t *out, WebSocketHeader::OpcodeType opcode, uint64_t payloadSize,
+                                    const uint8_t maskingKey[4], bool fin=true) {
+            const uint8_t maskBit = masked ? 0x80 : 0;
+            unsigned i;
+            out[0] = (fin ? 0x80 : 0) | opcode;
+            switch (frameLengthClass(payloadSize)) {
+                case LENGTH_7BIT:
+                    out[1] = (uint8_t) payloadSize | maskBit;
+                    i = 2;
+                    break;
+                case LENGTH_16BIT:
+                    out[1] = 126 | maskBit;
+                    out[2] = (payloadSize >> 8) & 0xff;
+                    out[3] = (payloadSize >> 0) & 0xff;
+                    i = 4;
+                    break;
+                default:
+                    out[1] = 127 | maskBit;
+                    for (unsigned k = 0; k != 8; ++k) {
+                        out[2 + k] = (payloadSize >> (56 - 8 * k)) & 0xff;
+                    }
+                    i = 10;
+                    break;
+            }
+            if (masked) {
+                memcpy(out + i, maskingKey, 4);
+                i += 4;
+            }
+            return i;
+        }
+
+        // in place, after the payload has been copied behind the header
+        static void maskPayload(uint8_t *data, size_t size, const uint8_t maskingKey[4]) {
+            if (masked) {
+                cppws::maskPayload(data, size, maskingKey);
+            }
+        }
+    };
+
+    // Walks the frames of a byte span without copying it. next() hands out one
+    // complete frame at a time, with a masked payload already unmasked in
+    // place, and stops at the first one that is cut off; consumed() is how
+    // much of the span the returned frames took, the caller keeps the rest
+    // and parses again once more bytes arrived.
+    class FrameParser {
+    public:
+        FrameParser(uint8_t *data, size_t size): data_(data), size_(size), consumed_(0), needed_(0) {
+        }
+
+        bool next(WebSocketHeader &ws, uint8_t *&payload) {
+            uint8_t *data = data_ + consumed_;
+            size_t available = size_ - consumed_;
+            if (available < 2) {
+                needed_ = 2;
+                return false;
+            }
+            ws.fin = (data[0] & 0x80) == 0x80;
+            ws.opcode = (WebSocketHeader::OpcodeType) (data[0] & 0x0f);
+            ws.mask = (data[1] & 0x80) == 0x80;
+            ws.N0 = (data[1] & 0x7f);
+            ws.headerSize = 2 + (ws.N0 == 126? 2 : 0) + (ws.N0 == 127? 8 : 0) + (ws.mask? 4 : 0);
+            if (available < ws.headerSize) {
+                needed_ = ws.headerSize;
+                return false;
+            }
+            unsigned i;
+            if (ws.N0 < 126) {
+                ws.N = ws.N0;
+                i = 2;
+            }
+            else if (ws.N0 == 126) {
+                ws.N = ((uint64_t) data[2] << 8) | data[3];
+                i = 4;
+            }
+            else {
+                ws.N = 0;
+                for (unsigned k = 0; k != 8; ++k) {
+                    ws.N = (ws.N << 8) | data[2 + k];
+                }
+                i = 10;
+            }
+            if (available - ws.headerSize < ws.N) {
+                needed_ = ws.headerSize + ws.N;
+                return false;
+            }
+            if (ws.mask) {
+                memcpy(ws.maskingKey, data + i, 4);
+            }
+            else {
+                memset(ws.maskingKey, 0, 4);
+            }
+            payload = data + ws.headerSize;
+            if (ws.mask) {
+                maskPayload(payload, (size_t) ws.N, ws.maskingKey);
+            }
+            consumed_ += ws.headerSize + (size_t) ws.N;
+            needed_ = 0;
+            return true;
+        }
+
+        size_t consumed() const {
+            return consumed_;
+        }
+
+        // size of the frame next() stopped at, counted from consumed()
+        uint64_t needed() const {
+            return needed_;
+        }
+
+    private:
+        uint8_t *data_;
+        size_t size_;
+        size_t consumed_;
+        uint64_t needed_;
+    };
+}
+
+#endif /* FrameCodec_hpp */
@@ -0,0 +1,201 @@
+//
+//  MessageDispatcher.cpp
+//  cppwebsocket
+//
+//  Worker pool and per-connection serial executor for onMessage dispatch.
+//
+
+#include "MessageDispatcher.hpp"
+
+namespace cppws {
+
+    // tasks an executor runs before giving its worker to the next executor
+    static const size_t executorBatchSize = 16;
+
+    WorkerPool::WorkerPool(size_t threads, size_t maxQueued) {
+        maxQueued_ = maxQueued > 0 ? maxQueued : 1;
+        stopped_ = false;
+        if (threads == 0) {
+            threads = 1;
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.push_back(std::thread([this]{
+                runWorker();
+            }));
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        shutdown();
+    }
+
+    bool WorkerPool::post(std::function<void()> job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this]{ return stopped_ || jobs_.size() < maxQueued_; });
+        if (stopped_) {
+            return false;
+        }
+        jobs_.push_back(std::move(job));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    bool WorkerPool::requeue(std::function<void()> job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_) {
+            return false;
+        }
+        jobs_.push_back(std::move(job));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    void WorkerPool::shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_) {
+                return;
+            }
+            stopped_ = true;
+        }
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+        for (auto &worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    size_t WorkerPool::queueDepth() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return jobs_.size();
+    }
+
+    void WorkerPool::runWorker() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                notEmpty_.wait(lock, [this]{ return stopped_ || !jobs_.empty(); });
+                // finish what was already queued before leaving
+                if (jobs_.empty()) {
+                    return;
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+                notFull_.notify_one();
+            }
+            job();
+            // release what the job captured now, not when the next one arrives
+            job = nullptr;
+        }
+    }
+
+    SerialExecutor::SerialExecutor(WorkerPool &pool, size_t maxPending) {
+        pool_ = &pool;
+        maxPending_ = maxPending > 0 ? maxPending : 1;
+        scheduled_ = false;
+        stats_ = DispatchStats();
+    }
+
+    void SerialExecutor::post(std::function<void()> task) {
+        bool schedule = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            notFull_.wait(lock, [this]{ return pending_.size() < maxPending_; });
+            Task t;
+            t.run = std::move(task);
+            t.queuedAt = Clock::now();
+            pending_.push_back(std::move(t));
+            stats_.dispatched++;
+            stats_.queueDepth = pending_.size();
+            if (stats_.queueDepth > stats_.maxQueueDepth) {
+                stats_.maxQueueDepth = stats_.queueDepth;
+            }
+            // at most one job per executor sits in the pool, that is what keeps the order
+            if (!scheduled_) {
+                scheduled_ = true;
+                schedule = true;
+            }
+        }
+        if (schedule) {
+            auto self = shared_from_this();
+            bool posted = pool_->post([self]{
+                self->runPending();
+            });
+            if (!posted) {
+                // pool is gone, keep the message rather than drop it
+                runPending();
+            }
+        }
+    }
+
+    void SerialExecutor::drain() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this]{ return !scheduled_; });
+    }
+
+    bool SerialExecutor::inTask() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return runner_ == std::this_thread::get_id();
+    }
+
+    DispatchStats SerialExecutor::stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void SerialExecutor::runPending() {
+        size_t ran = 0;
+        while (true) {
+            if (ran == executorBatchSize) {
+                ran = 0;
+                // scheduled_ stays set, the requeued job carries on from here
+                if (requeue()) {
+                    return;
+                }
+            }
+            Task task;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (pending_.empty()) {
+                    scheduled_ = false;
+                    idle_.notify_all();
+                    return;
+                }
+                task = std::move(pending_.front());
+                pending_.pop_front();
+                stats_.queueDepth = pending_.size();
+                runner_ = std::this_thread::get_id();
+                notFull_.notify_one();
+            }
+
+            Clock::time_point start = Clock::now();
+            task.run();
+            Clock::time_point end = Clock::now();
+            ++ran;
+
+            uint64_t wait = std::chrono::duration_cast<std::chrono::microseconds>(start - task.queuedAt).count();
+            uint64_t cost = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            std::lock_guard<std::mutex> lock(mutex_);
+            runner_ = std::thread::id();
+            stats_.handled++;
+            stats_.totalWaitMicros += wait;
+            stats_.totalHandlerMicros += cost;
+            if (wait > stats_.maxWaitMicros) {
+                stats_.maxWaitMicros = wait;
+            }
+            if (cost > stats_.maxHandlerMicros) {
+                stats_.maxHandlerMicros = cost;
+            }
+        }
+    }
+
+    bool SerialExecutor::requeue() {
+        auto self = shared_from_this();
+        return pool_->requeue([self]{
+            self->runPending();
+        });
+    }
+}
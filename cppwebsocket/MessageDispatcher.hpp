@@ -0,0 +1,109 @@
+//
+//  MessageDispatcher.hpp
+//  cppwebsocket
+//
+//  Worker pool and per-connection serial executor for onMessage dispatch.
+//
+
+#ifndef MessageDispatcher_hpp
+#define MessageDispatcher_hpp
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cppws {
+
+    // A fixed set of worker threads shared by any number of connections.
+    // post() blocks while `maxQueued` jobs are already waiting, so a slow
+    // consumer pushes back on the producer instead of growing without bound.
+    class WorkerPool {
+    public:
+        WorkerPool(size_t threads, size_t maxQueued=1024);
+        ~WorkerPool();
+
+        // false once the pool has been shut down, the job is not run then
+        bool post(std::function<void()> job);
+        // like post() but never waits for room, for jobs that put themselves
+        // back in line (each SerialExecutor has at most one job queued)
+        bool requeue(std::function<void()> job);
+        // must not be called from one of the pool's own threads
+        void shutdown();
+
+        size_t queueDepth() const;
+
+    private:
+        void runWorker();
+
+    private:
+        std::vector<std::thread> workers_;
+        std::deque<std::function<void()> > jobs_;
+        size_t maxQueued_;
+        bool stopped_;
+        mutable std::mutex mutex_;
+        std::condition_variable notEmpty_;
+        std::condition_variable notFull_;
+    };
+
+    struct DispatchStats {
+        size_t queueDepth;          // messages waiting for the handler now
+        size_t maxQueueDepth;       // high-water mark of queueDepth
+        uint64_t dispatched;        // messages handed over by the I/O thread
+        uint64_t handled;           // messages the handler has returned from
+        uint64_t totalWaitMicros;   // time spent queued, summed over handled
+        uint64_t maxWaitMicros;
+        uint64_t totalHandlerMicros;// time spent in the handler, summed over handled
+        uint64_t maxHandlerMicros;
+    };
+
+    // Runs the tasks posted to it one after another, in posting order, on a
+    // WorkerPool. Different executors on the same pool run in parallel, so one
+    // executor per connection keeps each connection ordered without making
+    // connections wait for each other. After a batch of tasks the executor
+    // goes to the back of the pool queue, so a busy connection cannot keep a
+    // worker to itself.
+    //
+    // The executor does not own the pool, the pool must outlive it.
+    class SerialExecutor: public std::enable_shared_from_this<SerialExecutor> {
+    public:
+        SerialExecutor(WorkerPool &pool, size_t maxPending=1024);
+
+        void post(std::function<void()> task);
+        // block until every task posted so far has finished
+        void drain();
+        // true inside one of this executor's tasks
+        bool inTask() const;
+
+        DispatchStats stats() const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+        struct Task {
+            std::function<void()> run;
+            Clock::time_point queuedAt;
+        };
+
+        void runPending();
+        bool requeue();
+
+    private:
+        WorkerPool *pool_;
+        std::deque<Task> pending_;
+        size_t maxPending_;
+        bool scheduled_;
+        std::thread::id runner_;
+        DispatchStats stats_;
+        mutable std::mutex mutex_;
+        std::condition_variable notFull_;
+        std::condition_variable idle_;
+    };
+}
+
+#endif /* MessageDispatcher_hpp */
@@ -142,3 +142,35 @@ socket_t OpenWebSocketURL(const std::string& url, const std::string& origin)
     fprintf(stderr, "Connected to: %s\n", url.c_str());
     return sockfd;
 }
+
+bool SetSocketBusyPoll(socket_t sockfd, int micros)
+{
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    if (setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, (char*) &micros, sizeof(micros)) != 0) {
+        fprintf(stderr, "WARNING: SO_BUSY_POLL not set: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+#else
+    fprintf(stderr, "WARNING: SO_BUSY_POLL is not supported on this platform\n");
+    return false;
+#endif
+}
+
+bool PinCurrentThreadToCpu(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        fprintf(stderr, "WARNING: Could not pin thread to cpu %d: %s\n", cpu, strerror(ret));
+        return false;
+    }
+    return true;
+#else
+    fprintf(stderr, "WARNING: Thread pinning is not supported on this platform\n");
+    return false;
+#endif
+}
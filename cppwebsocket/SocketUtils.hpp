@@ -56,6 +56,10 @@ typedef unsigned __int64 uint64_t;
 #include <sys/types.h>
 #include <unistd.h>
 #include <stdint.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #ifndef _SOCKET_T_DEFINED
 typedef int socket_t;
 #define _SOCKET_T_DEFINED
@@ -76,5 +80,9 @@ typedef int socket_t;
 #include <string>
 
 socket_t OpenWebSocketURL(const std::string& url, const std::string& origin);
+// let the kernel busy poll the device queue for `micros` on blocking reads (SO_BUSY_POLL, linux only)
+bool SetSocketBusyPoll(socket_t sockfd, int micros);
+// bind the calling thread to one cpu (linux only)
+bool PinCurrentThreadToCpu(int cpu);
 
 #endif
@@ -7,13 +7,19 @@
 //
 
 #include "WebSocketClient.hpp"
+#include <chrono>
 #include <iostream>
 
 namespace cppws {
     
     WebSocketClient::WebSocketClient(const std::vector<std::string> &strUrls, bool useMask) {
-        useMask_ = useMask;
+        this->useMask(useMask);
         readyState_ = INIT;
+        pollMode_ = POLL_BLOCKING;
+        spinMicros_ = 50;
+        pinnedCpu_ = -1;
+        busyPollMicros_ = 0;
+        pendingSend_ = 0;
         // 反向插入，获取的时候也是从后往前
         serviceUrls_.assign(strUrls.rbegin(), strUrls.rend());
     }
@@ -23,7 +29,43 @@ namespace cppws {
     }
     
     void WebSocketClient::useMask(bool mask) {
-        useMask_ = mask;
+        sendFrame_ = mask ? &WebSocketClient::sendFrame<ROLE_CLIENT> : &WebSocketClient::sendFrame<ROLE_SERVER>;
+    }
+    
+    void WebSocketClient::dispatchOn(const std::shared_ptr<WorkerPool> &pool, size_t maxPending) {
+        executor_.reset();
+        pool_ = pool;
+        if (pool) {
+            executor_ = std::make_shared<SerialExecutor>(*pool, maxPending);
+        }
+    }
+    
+    DispatchStats WebSocketClient::dispatchStats() const {
+        if (executor_) {
+            return executor_->stats();
+        }
+        return DispatchStats();
+    }
+    
+    void WebSocketClient::setPollMode(PollMode mode, int spinMicros) {
+        pollMode_ = mode;
+        spinMicros_ = spinMicros;
+    }
+    
+    void WebSocketClient::pinToCpu(int cpu) {
+        pinnedCpu_ = cpu;
+    }
+    
+    void WebSocketClient::setBusyPoll(int micros) {
+        busyPollMicros_ = micros;
+    }
+    
+    bool WebSocketClient::captureTo(const std::string &path) {
+        if (path.empty()) {
+            capture_.close();
+            return true;
+        }
+        return capture_.open(path);
     }
     
     void WebSocketClient::open() {
@@ -48,6 +90,11 @@ namespace cppws {
     
     void WebSocketClient::close() {
         sendClose();
+        // called from a handler: the I/O thread waits for that handler to return,
+        // joining it here would never finish
+        if (std::this_thread::get_id() == serviceThread_.get_id() || (executor_ && executor_->inTask())) {
+            return;
+        }
         if (serviceThread_.joinable()) {
             serviceThread_.join();
         }
@@ -57,6 +104,7 @@ namespace cppws {
         std::lock_guard<std::recursive_mutex> lock(sendMutex_);
         // clean the pending messsage, make close quickly
         sendBuff_.clear();
+        pendingSend_ = 0;
         close();
     }
     
@@ -64,24 +112,41 @@ namespace cppws {
         const static int timeout = 100;
         const static int rbuffsize = 1500;
         const static int maxPendingSendSize = 1024;
+        typedef std::chrono::steady_clock Clock;
         
+        if (pinnedCpu_ >= 0) {
+            PinCurrentThreadToCpu(pinnedCpu_);
+        }
         socket_t sockfd = OpenWebSocketURL(nextServiceAddress(), "");
         if (sockfd != INVALID_SOCKET) {
+            if (busyPollMicros_ > 0) {
+                SetSocketBusyPoll(sockfd, busyPollMicros_);
+            }
+            if (capture_.isOpen()) {
+                capture_.beginConnection();
+            }
             if (onOpen) {
                 onOpen();
             }
             
-            std::string fullMessage;
+            // nothing left over from the previous connection
+            recvBuff_.clear();
+            recvMessage_.clear();
+            const Clock::duration spinWindow = std::chrono::microseconds(spinMicros_);
+            Clock::time_point lastActivity = Clock::now();
             while (readyState_ != CLOSED) {
+                bool spinning = pollMode_ == POLL_SPIN
+                    || (pollMode_ == POLL_HYBRID && Clock::now() - lastActivity < spinWindow);
+                bool active = false;
                 // select 
-                if (timeout != 0) {
+                if (timeout != 0 && !spinning) {
                     fd_set rfds;
                     fd_set wfds;
                     timeval tv = { timeout/1000, (timeout%1000) * 1000 };
                     FD_ZERO(&rfds);
                     FD_ZERO(&wfds);
                     FD_SET(sockfd, &rfds);
-                    if (sendBuff_.size()) { FD_SET(sockfd, &wfds); }
+                    if (pendingSend_ > 0) { FD_SET(sockfd, &wfds); }
                     select(sockfd + 1, &rfds, &wfds, 0, timeout > 0 ? &tv : 0);
                 }
                 
@@ -104,23 +169,26 @@ namespace cppws {
                     }
                     else {
                         recvBuff_.resize(N + ret);
-                        
-                        // dispatch received message
-                        while(extractReceivedMessage(fullMessage)) {
-                            if (onMessage) {
-                                onMessage(fullMessage);
-                            }
-                            fullMessage.clear();
-                            std::string().swap(fullMessage);  // free memory
-                        }                        
+                        active = true;
+                        if (capture_.isOpen()) {
+                            capture_.append(&recvBuff_[N], ret);
+                        }
+                        dispatchReceived();
                     }
                     // check if pending send buffer is too large
-                    std::lock_guard<std::recursive_mutex> lock(sendMutex_);
-                    if (sendBuff_.size() > maxPendingSendSize) {
+                    if (pendingSend_ > maxPendingSendSize) {
                         break;
                     }
                 }
-                                
+                
+                // nothing to send, don't touch the lock
+                if (pendingSend_ == 0 && readyState_ != CLOSING) {
+                    if (active) {
+                        lastActivity = Clock::now();
+                    }
+                    continue;
+                }
+                
                 // send all pending messages
                 std::lock_guard<std::recursive_mutex> lock(sendMutex_);
                 while (sendBuff_.size() && readyState_ != CLOSED) {
@@ -136,8 +204,13 @@ namespace cppws {
                     }
                     else {
                         sendBuff_.erase(sendBuff_.begin(), sendBuff_.begin() + ret);
+                        active = true;
                     }
                 }
+                pendingSend_ = sendBuff_.size();
+                if (active) {
+                    lastActivity = Clock::now();
+                }
                 
                 // handle closing case
                 if (sendBuff_.size() == 0 && readyState_ == CLOSING) {
@@ -147,133 +220,92 @@ namespace cppws {
             }
             closesocket(sockfd);
         }        
+        capture_.flush();
         readyState_ = CLOSED;
+        // onClosed comes after every message of this connection
+        if (executor_) {
+            executor_->drain();
+        }
         if (onClosed) {
             onClosed();
         }
     }
     
-    bool WebSocketClient::extractReceivedMessage(std::string &fullMessage) {
-        while (true) {
-            WebSocketHeader ws;
-            if (recvBuff_.size() < 2) { 
-                return false; /* Need at least 2 */ 
-            }
-            const uint8_t * data = (uint8_t *) &recvBuff_[0]; // peek, but don't consume
-            ws.fin = (data[0] & 0x80) == 0x80;
-            ws.opcode = (WebSocketHeader::OpcodeType) (data[0] & 0x0f);
-            ws.mask = (data[1] & 0x80) == 0x80;
-            ws.N0 = (data[1] & 0x7f);
-            ws.headerSize = 2 + (ws.N0 == 126? 2 : 0) + (ws.N0 == 127? 8 : 0) + (ws.mask? 4 : 0);
-            if (recvBuff_.size() < ws.headerSize) { 
-                return false; /* Need: ws.headerSize - recvBuff_.size() */ 
-            }
-            int i = 0;
-            if (ws.N0 < 126) {
-                ws.N = ws.N0;
-                i = 2;
-            }
-            else if (ws.N0 == 126) {
-                ws.N = 0;
-                ws.N |= ((uint64_t) data[2]) << 8;
-                ws.N |= ((uint64_t) data[3]) << 0;
-                i = 4;
-            }
-            else if (ws.N0 == 127) {
-                ws.N = 0;
-                ws.N |= ((uint64_t) data[2]) << 56;
-                ws.N |= ((uint64_t) data[3]) << 48;
-                ws.N |= ((uint64_t) data[4]) << 40;
-                ws.N |= ((uint64_t) data[5]) << 32;
-                ws.N |= ((uint64_t) data[6]) << 24;
-                ws.N |= ((uint64_t) data[7]) << 16;
-                ws.N |= ((uint64_t) data[8]) << 8;
-                ws.N |= ((uint64_t) data[9]) << 0;
-                i = 10;
-            }
-
-            if (recvBuff_.size() < ws.headerSize+ws.N) { 
-                return false; /* Need: ws.headerSize+ws.N - recvBuff_.size() */ 
-            }
-            
-            if (ws.mask) {
-                ws.maskingKey[0] = ((uint8_t) data[i+0]) << 0;
-                ws.maskingKey[1] = ((uint8_t) data[i+1]) << 0;
-                ws.maskingKey[2] = ((uint8_t) data[i+2]) << 0;
-                ws.maskingKey[3] = ((uint8_t) data[i+3]) << 0;
-            }
-            else {
-                ws.maskingKey[0] = 0;
-                ws.maskingKey[1] = 0;
-                ws.maskingKey[2] = 0;
-                ws.maskingKey[3] = 0;
-            }
+    void WebSocketClient::dispatchMessage(std::string &message) {
+        if (executor_) {
+            // the task owns the buffer now, nothing is copied
+            executor_->post(std::bind([this](const std::string &msg) {
+                if (onMessage) {
+                    onMessage(msg);
+                }
+            }, std::move(message)));
+        }
+        else if (onMessage) {
+            onMessage(message);
+        }
+        message.clear();
+        std::string().swap(message);  // free memory
+    }
+    
+    size_t WebSocketClient::dispatchReceived() {
+        if (recvBuff_.empty()) {
+            return 0;
+        }
+        // one pass over everything received so far, the bytes of a cut off
+        // frame stay at the front of recvBuff_ for the next read
+        uint8_t *data = &recvBuff_[0];
+        FrameParser parser(data, recvBuff_.size());
+        WebSocketHeader ws;
+        uint8_t *payload;
+        size_t count = 0;
+        while (parser.next(ws, payload)) {
+            size_t N = (size_t)ws.N;
             
-            // We got a whole message, now do something with it:
+            // We got a whole frame, now do something with it:
             if (
                 ws.opcode == WebSocketHeader::TEXT_FRAME 
                 || ws.opcode == WebSocketHeader::BINARY_FRAME
                 || ws.opcode == WebSocketHeader::CONTINUATION
                 ) {
-                
-                if (ws.mask) { 
-                    for (size_t i = 0; i != ws.N; ++i) { 
-                        recvBuff_[i+ws.headerSize] ^= ws.maskingKey[i&0x3]; 
-                    } 
-                }
-                
-                fullMessage.insert(fullMessage.end(), recvBuff_.begin()+ws.headerSize, recvBuff_.begin()+ws.headerSize+(size_t)ws.N);// just feed
+                recvMessage_.append((const char *)payload, N);// just feed
                 if (ws.fin) {
-                    recvBuff_.erase(recvBuff_.begin(), recvBuff_.begin() + ws.headerSize+(size_t)ws.N);                    
-                    return true;
+                    dispatchMessage(recvMessage_);
+                    ++count;
                 }
             }
             else if (ws.opcode == WebSocketHeader::PING) {
-                if (ws.mask) { 
-                    for (size_t i = 0; i != ws.N; ++i) {
-                        recvBuff_[i+ws.headerSize] ^= ws.maskingKey[i&0x3]; 
-                    } 
-                }
-                sendData(WebSocketHeader::PONG, (size_t)ws.N, [this, &ws]{
-                    sendBuff_.insert(sendBuff_.end(), recvBuff_.begin()+ws.headerSize, recvBuff_.begin()+ws.headerSize+(size_t)ws.N);
-                });
+                sendData(WebSocketHeader::PONG, payload, N);
             }
             else if (ws.opcode == WebSocketHeader::PONG) { 
             }
             else if (ws.opcode == WebSocketHeader::CLOSE) { 
                 sendClose(); 
+                break;
             }
             else { 
                 std::cerr << "ERROR: Got unexpected WebSocket message." << std::endl; 
                 sendClose(); 
+                break;
             }
-            
-            recvBuff_.erase(recvBuff_.begin(), recvBuff_.begin() + ws.headerSize+(size_t)ws.N);
-            return false;
         }
+        recvBuff_.erase(recvBuff_.begin(), recvBuff_.begin() + parser.consumed());
+        return count;
     }
     
     void WebSocketClient::sendMessage(const std::string &message) {
-        sendData(WebSocketHeader::TEXT_FRAME, message.size(), [this, &message]{
-            sendBuff_.insert(sendBuff_.end(), message.begin(), message.end());
-        });
+        sendData(WebSocketHeader::TEXT_FRAME, (const uint8_t *)message.data(), message.size());
     }
     
     void WebSocketClient::sendBinary(const std::string &message) {
-        sendData(WebSocketHeader::BINARY_FRAME, message.size(), [this, &message]{
-            sendBuff_.insert(sendBuff_.end(), message.begin(), message.end());
-        });
+        sendData(WebSocketHeader::BINARY_FRAME, (const uint8_t *)message.data(), message.size());
     }
     
     void WebSocketClient::sendBinary(const std::vector<uint8_t> &message) {
-        sendData(WebSocketHeader::BINARY_FRAME, message.size(), [this, &message]{
-            sendBuff_.insert(sendBuff_.end(), message.begin(), message.end());
-        });
+        sendData(WebSocketHeader::BINARY_FRAME, message.data(), message.size());
     }
     
     void WebSocketClient::sendPing() {
-        std::string empty;
-        sendData(WebSocketHeader::PING, empty.size(), nullptr);
+        sendData(WebSocketHeader::PING, NULL, 0);
     }
     
     void WebSocketClient::sendClose() {
@@ -282,67 +314,31 @@ namespace cppws {
         }
         readyState_ = CLOSING;
         
-        std::string close;
-        sendData(WebSocketHeader::CLOSE, close.size(), nullptr);
+        sendData(WebSocketHeader::CLOSE, NULL, 0);
     }
     
-    void WebSocketClient::sendData(WebSocketHeader::OpcodeType type, uint64_t messageSize, std::function<void()> appendPlayload) {
+    void WebSocketClient::sendData(WebSocketHeader::OpcodeType type, const uint8_t *payload, size_t size) {
+        (this->*sendFrame_)(type, payload, size);
+    }
+    
+    template<FrameRole R>
+    void WebSocketClient::sendFrame(WebSocketHeader::OpcodeType type, const uint8_t *payload, size_t size) {
         // TODO:
         // Masking key should (must) be derived from a high quality random
         // number generator, to mitigate attacks on non-WebSocket friendly
         // middleware:
         const uint8_t maskingKey[4] = { 0x12, 0x34, 0x56, 0x78 };        
-        std::vector<uint8_t> header;
-        header.assign(2 + (messageSize >= 126 ? 2 : 0) + (messageSize >= 65536 ? 6 : 0) + (useMask_ ? 4 : 0), 0);
-        header[0] = 0x80 | type;
-        if (messageSize < 126) {
-            header[1] = (messageSize & 0xff) | (useMask_ ? 0x80 : 0);
-            if (useMask_) {
-                header[2] = maskingKey[0];
-                header[3] = maskingKey[1];
-                header[4] = maskingKey[2];
-                header[5] = maskingKey[3];
-            }
-        }
-        else if (messageSize < 65536) {
-            header[1] = 126 | (useMask_ ? 0x80 : 0);
-            header[2] = (messageSize >> 8) & 0xff;
-            header[3] = (messageSize >> 0) & 0xff;
-            if (useMask_) {
-                header[4] = maskingKey[0];
-                header[5] = maskingKey[1];
-                header[6] = maskingKey[2];
-                header[7] = maskingKey[3];
-            }
-        }
-        else { // TODO: run coverage testing here
-            header[1] = 127 | (useMask_ ? 0x80 : 0);
-            header[2] = (messageSize >> 56) & 0xff;
-            header[3] = (messageSize >> 48) & 0xff;
-            header[4] = (messageSize >> 40) & 0xff;
-            header[5] = (messageSize >> 32) & 0xff;
-            header[6] = (messageSize >> 24) & 0xff;
-            header[7] = (messageSize >> 16) & 0xff;
-            header[8] = (messageSize >>  8) & 0xff;
-            header[9] = (messageSize >>  0) & 0xff;
-            if (useMask_) {
-                header[10] = maskingKey[0];
-                header[11] = maskingKey[1];
-                header[12] = maskingKey[2];
-                header[13] = maskingKey[3];
-            }
-        }
+        uint8_t header[kMaxFrameHeaderSize];
+        unsigned headerSize = FrameEncoder<R>::writeHeader(header, type, size, maskingKey);
         
         std::lock_guard<std::recursive_mutex> lock(sendMutex_);
         // N.B. - txbuf will keep growing until it can be transmitted over the socket:
-        sendBuff_.insert(sendBuff_.end(), header.begin(), header.end());
-        
-        if (appendPlayload) {
-            appendPlayload();
-        }
-        if (useMask_) {
-            for (size_t i = 0; i != messageSize; ++i) { *(sendBuff_.end() - messageSize + i) ^= maskingKey[i&0x3]; }
+        sendBuff_.insert(sendBuff_.end(), header, header + headerSize);
+        if (size > 0) {
+            sendBuff_.insert(sendBuff_.end(), payload, payload + size);
+            FrameEncoder<R>::maskPayload(&sendBuff_[sendBuff_.size() - size], size, maskingKey);
         }
+        pendingSend_ = sendBuff_.size();
         // TODO: maybe define a overflow control;
     }    
 }
@@ -10,7 +10,11 @@
 #define WebSocketClient_hpp
 
 #include "SocketUtils.hpp"
+#include "FrameCodec.hpp"
+#include "FrameCapture.hpp"
+#include "MessageDispatcher.hpp"
 
+#include <atomic>
 #include <string>
 #include <thread>
 #include <functional>
@@ -24,44 +28,13 @@ namespace cppws {
         CLOSING, 
         CLOSED, 
     };
-
-    // http://tools.ietf.org/html/rfc6455#section-5.2  Base Framing Protocol
-    //
-    //  0                   1                   2                   3
-    //  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-    // +-+-+-+-+-------+-+-------------+-------------------------------+
-    // |F|R|R|R| opcode|M| Payload len |    Extended payload length    |
-    // |I|S|S|S|  (4)  |A|     (7)     |             (16/64)           |
-    // |N|V|V|V|       |S|             |   (if payload len==126/127)   |
-    // | |1|2|3|       |K|             |                               |
-    // +-+-+-+-+-------+-+-------------+ - - - - - - - - - - - - - - - +
-    // |     Extended payload length continued, if payload len == 127  |
-    // + - - - - - - - - - - - - - - - +-------------------------------+
-    // |                               |Masking-key, if MASK set to 1  |
-    // +-------------------------------+-------------------------------+
-    // | Masking-key (continued)       |          Payload Data         |
-    // +-------------------------------- - - - - - - - - - - - - - - - +
-    // :                     Payload Data continued ...                :
-    // + - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - +
-    // |                     Payload Data continued ...                |
-    // +---------------------------------------------------------------+
-    struct WebSocketHeader {
-        unsigned headerSize;
-        bool fin;
-        bool mask;
-        enum OpcodeType {
-            CONTINUATION = 0x0,
-            TEXT_FRAME = 0x1,
-            BINARY_FRAME = 0x2,
-            CLOSE = 8,
-            PING = 9,
-            PONG = 0xa,
-        } opcode;
-        int N0;
-        uint64_t N;
-        uint8_t maskingKey[4];
-    };
     
+    enum PollMode: int {
+        POLL_BLOCKING,  // sleep in select() until the socket is ready
+        POLL_SPIN,      // never sleep, poll the socket in a tight loop, costs a whole core
+        POLL_HYBRID,    // spin while there is traffic, select() after `spinMicros` of silence
+    };
+
     class WebSocketClient {
     public:
         WebSocketClient(const std::vector<std::string> &strUrls, bool useMask=true);
@@ -77,6 +50,26 @@ namespace cppws {
         void sendPing();
         void sendClose();
         
+        // call onMessage on `pool` instead of the I/O thread, messages of this
+        // connection are still delivered one at a time and in order.
+        // the I/O thread blocks once `maxPending` messages are waiting.
+        // close() from inside onMessage only starts the closing handshake,
+        // the I/O thread is joined by the next open(), close() or the destructor.
+        // must be called before open()
+        void dispatchOn(const std::shared_ptr<WorkerPool> &pool, size_t maxPending=1024);
+        DispatchStats dispatchStats() const;
+        
+        // the following take effect on the next open()
+        void setPollMode(PollMode mode, int spinMicros=50);
+        // pin the I/O thread to `cpu`, -1 leaves it to the scheduler
+        void pinToCpu(int cpu);
+        // SO_BUSY_POLL on the socket, 0 leaves the system default
+        void setBusyPoll(int micros);
+        // append every chunk read from the socket to `path`, for FrameReplayer.
+        // recording goes on across reconnects until captureTo("") or destruction.
+        // must not be called while the connection is open
+        bool captureTo(const std::string &path);
+        
     public:
         // call back interface
         std::function<void ()> onOpen;
@@ -89,8 +82,13 @@ namespace cppws {
         void runPollInThread();
         
     private:
-        void sendData(WebSocketHeader::OpcodeType type, uint64_t message_size, std::function<void()> appendPlayload);
-        bool extractReceivedMessage(std::string &receivedMessage);
+        void sendData(WebSocketHeader::OpcodeType type, const uint8_t *payload, size_t size);
+        template<FrameRole R>
+        void sendFrame(WebSocketHeader::OpcodeType type, const uint8_t *payload, size_t size);
+        void dispatchMessage(std::string &message);
+        size_t dispatchReceived();
+        
+        friend class FrameReplayer;
         
     private:
         std::vector<std::string> serviceUrls_;
@@ -98,11 +96,25 @@ namespace cppws {
         std::thread serviceThread_;
                 
         ReadyStateValues readyState_;
-        bool useMask_;
+        // sendFrame<ROLE_CLIENT> or sendFrame<ROLE_SERVER>, picked by useMask()
+        void (WebSocketClient::*sendFrame_)(WebSocketHeader::OpcodeType type, const uint8_t *payload, size_t size);
+        
+        PollMode pollMode_;
+        int spinMicros_;
+        int pinnedCpu_;
+        int busyPollMicros_;
         
         std::vector<uint8_t> recvBuff_;
+        std::string recvMessage_;
+        FrameCaptureWriter capture_;
         std::vector<uint8_t> sendBuff_;
         std::recursive_mutex sendMutex_;
+        // sendBuff_.size(), readable without taking sendMutex_
+        std::atomic<size_t> pendingSend_;
+        
+        // executor_ only points at the pool, keep it alive for as long
+        std::shared_ptr<WorkerPool> pool_;
+        std::shared_ptr<SerialExecutor> executor_;
     };    
 }
 